@@ -0,0 +1,78 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+// Test hook for the allocation-free write path. Building with -DCOUNT_ALLOCATIONS
+// interposes the C allocation functions (glibc supports replacing malloc) and
+// counts every call that allocates. This covers direct malloc/calloc/realloc,
+// plain and aligned operator new (which allocate through malloc and
+// aligned_alloc), and allocations made inside libc. Memory still comes from
+// the glibc allocator, so pointers may be freed through either path.
+// Include from exactly one translation unit of a binary.
+
+#ifdef COUNT_ALLOCATIONS
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* p);
+}
+
+std::atomic<size_t> allocation_count{0};
+
+inline void count_allocation() {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" {
+void* malloc(size_t size) noexcept {
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) noexcept {
+    count_allocation();
+    return __libc_realloc(p, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** result, size_t alignment, size_t size) noexcept {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    count_allocation();
+    void* p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *result = p;
+    return 0;
+}
+
+void free(void* p) noexcept {
+    __libc_free(p);
+}
+}
+
+const bool ALLOCATION_COUNTING_ENABLED = true;
+inline size_t allocations_so_far() { return allocation_count.load(std::memory_order_relaxed); }
+#else
+const bool ALLOCATION_COUNTING_ENABLED = false;
+inline size_t allocations_so_far() { return 0; }
+#endif
+
+#endif // ALLOC_COUNTER_H
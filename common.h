@@ -10,21 +10,37 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
 #include <stdexcept>
 #include <vector>
+#include <thread>
+#include <algorithm>
+#include "hugepage.h"
 
 // Constants for PMEM configuration
 const size_t PAGE_SIZE = 4096;          // Page size in bytes
 const size_t NUM_PAGES = 1000;         // Number of pages
 const size_t PMEM_FILE_SIZE = PAGE_SIZE * NUM_PAGES; // Total PMEM file size
 extern const char* PMEM_FILE_PATH;
+const uint64_t DEFAULT_PMEM_SEED = 42;  // Seed for the initial PMEM image
 
 // Write structure for generating random write data
 struct Write {
     std::vector<uint8_t> data;
 
+    Write() : data(PAGE_SIZE, 0) {}
+
     Write(const std::string& str) : data(PAGE_SIZE, 0) {
-        memcpy(data.data(), str.c_str(), str.size());
+        assign(str.data(), str.size());
+    }
+
+    // Reuse this write's page buffer for new content, zero-padded to PAGE_SIZE
+    void assign(const char* str, size_t length) {
+        length = std::min(length, PAGE_SIZE);
+        memcpy(data.data(), str, length);
+        memset(data.data() + length, 0, PAGE_SIZE - length);
     }
 
     const uint8_t* get_page() const {
@@ -45,8 +61,11 @@ inline size_t count_bit_flips(const uint8_t* data1, const uint8_t* data2, size_t
     return flips;
 }
 
-// Function to initialize and map the PMEM file
-inline uint8_t* init_pmem() {
+// Function to initialize and map the PMEM file. With huge_pages the mapping is
+// advised for transparent huge pages and then prefaulted, so the first faults
+// already see the advice. MAP_HUGETLB is rejected for regular files; a file on
+// hugetlbfs is huge-page backed as is.
+inline uint8_t* init_pmem(bool huge_pages = false) {
     int fd = open(PMEM_FILE_PATH, O_RDWR | O_CREAT, 0666);
     if (fd < 0) {
         throw std::runtime_error("Failed to open persistent memory file.");
@@ -64,15 +83,129 @@ inline uint8_t* init_pmem() {
         throw std::runtime_error("Failed to map persistent memory.");
     }
 
+    if (huge_pages) {
+        if (madvise(pmem, PMEM_FILE_SIZE, MADV_HUGEPAGE) != 0) {
+            munmap(pmem, PMEM_FILE_SIZE);
+            throw std::runtime_error("Failed to advise huge pages for persistent memory.");
+        }
+        // Prefault; without MADV_POPULATE_WRITE, touch every page instead
+        if (!populate_for_write(pmem, PMEM_FILE_SIZE)) {
+            volatile uint8_t* pages = pmem;
+            for (size_t i = 0; i < PMEM_FILE_SIZE; i += PAGE_SIZE) {
+                pages[i] = pages[i];
+            }
+        }
+    }
+
     return pmem;
 }
 
-// Function to reset PMEM content
-inline void reset_pmem(uint8_t* pmem) {
-    // memset(pmem, 0, PMEM_FILE_SIZE); // Set all memory to zero
-    srand(time(NULL));
-    for (size_t i = 0; i < PMEM_FILE_SIZE; i++) {
-        ((unsigned char *)pmem)[i] = rand() & 0xFF;
+// Run fn(begin, end) over [0, size) split into one contiguous range per hardware thread
+template <typename Fn>
+inline void parallel_for_range(size_t size, Fn fn) {
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk = (size + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    for (size_t begin = 0; begin < size; begin += chunk) {
+        threads.emplace_back(fn, begin, std::min(begin + chunk, size));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// SplitMix64 finalizer; output i of the stream seeded with s is splitmix64_mix(s + (i + 1) * gamma)
+inline uint64_t splitmix64_mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Function to reset PMEM content. Every 8-byte word is derived only from the
+// seed and its offset, so the image is identical for any thread count.
+inline void reset_pmem(uint8_t* pmem, uint64_t seed = DEFAULT_PMEM_SEED) {
+    const uint64_t gamma = 0x9E3779B97F4A7C15ULL;
+    size_t num_words = PMEM_FILE_SIZE / sizeof(uint64_t);
+    parallel_for_range(num_words, [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint64_t word = splitmix64_mix(seed + (i + 1) * gamma);
+            memcpy(pmem + i * sizeof(uint64_t), &word, sizeof(uint64_t));
+        }
+    });
+    for (size_t i = num_words * sizeof(uint64_t); i < PMEM_FILE_SIZE; i++) {
+        pmem[i] = splitmix64_mix(seed + (i + 1) * gamma) & 0xFF;
+    }
+}
+
+// Function to save the current PMEM content as an image file
+inline void save_pmem_image(const uint8_t* pmem, const std::string& image_path) {
+    int fd = open(image_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create PMEM image file: " + image_path);
+    }
+
+    size_t written = 0;
+    while (written < PMEM_FILE_SIZE) {
+        ssize_t n = write(fd, pmem + written, PMEM_FILE_SIZE - written);
+        if (n <= 0) {
+            close(fd);
+            throw std::runtime_error("Failed to write PMEM image file: " + image_path);
+        }
+        written += n;
+    }
+    close(fd);
+}
+
+// Function to restore PMEM content from an image file. A reflink clone of the
+// image onto the PMEM file is tried first; filesystems without reflink support
+// (including DAX) fall back to a parallel copy from a read-only mapping.
+inline void restore_pmem_image(uint8_t* pmem, const std::string& image_path) {
+    int src = open(image_path.c_str(), O_RDONLY);
+    if (src < 0) {
+        throw std::runtime_error("Failed to open PMEM image file: " + image_path);
+    }
+
+    struct stat st;
+    if (fstat(src, &st) != 0 || static_cast<size_t>(st.st_size) != PMEM_FILE_SIZE) {
+        close(src);
+        throw std::runtime_error("PMEM image size does not match PMEM_FILE_SIZE: " + image_path);
+    }
+
+#ifdef FICLONE
+    int dst = open(PMEM_FILE_PATH, O_RDWR);
+    if (dst >= 0) {
+        bool cloned = ioctl(dst, FICLONE, src) == 0;
+        close(dst);
+        if (cloned) {
+            close(src);
+            return;
+        }
+    }
+#endif
+
+    uint8_t* image = (uint8_t*)mmap(nullptr, PMEM_FILE_SIZE, PROT_READ, MAP_SHARED, src, 0);
+    close(src);
+    if (image == MAP_FAILED) {
+        throw std::runtime_error("Failed to map PMEM image file: " + image_path);
+    }
+
+    parallel_for_range(PMEM_FILE_SIZE, [=](size_t begin, size_t end) {
+        memcpy(pmem + begin, image + begin, end - begin);
+    });
+    munmap(image, PMEM_FILE_SIZE);
+}
+
+// Function to bring PMEM to the starting image for a seed. The first run
+// generates the image and saves it; later runs restore it, so every policy
+// starts from byte-identical content.
+inline void prepare_pmem(uint8_t* pmem, uint64_t seed, const std::string& image_path) {
+    if (image_path.empty()) {
+        reset_pmem(pmem, seed);
+    } else if (access(image_path.c_str(), F_OK) == 0) {
+        restore_pmem_image(pmem, image_path);
+    } else {
+        reset_pmem(pmem, seed);
+        save_pmem_image(pmem, image_path);
     }
 }
 
@@ -81,7 +214,7 @@ inline std::string generate_random_string(size_t length) {
     const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
     std::string result;
     result.reserve(length);
-    std::default_random_engine rng(std::random_device{}());
+    thread_local std::default_random_engine rng(std::random_device{}());
     std::uniform_int_distribution<> dist(0, sizeof(charset) - 2);
     for (size_t i = 0; i < length; i++) {
         result += charset[dist(rng)];
@@ -1,6 +1,5 @@
 #include "common.h"
-#include <fstream>
-#include <sstream>
+#include "trace.h"
 #include <functional>
 
 // Specify PMEM file path
@@ -8,32 +7,28 @@ const char* PMEM_FILE_PATH = "/mnt/pmem/testfile";
 
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <csv_file>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <trace_file> [seed] [image_file]" << std::endl;
         return 1;
     }
 
     try {
+        // Seed of the initial PMEM content and optional image file to share it across runs
+        uint64_t seed = (argc >= 3) ? parse_unsigned_argument(argv[2], "seed") : DEFAULT_PMEM_SEED;
+        std::string image_path = (argc >= 4) ? argv[3] : "";
+        srand(seed);
+
         // Initialize PMEM
         uint8_t* pmem = init_pmem();
 
         // Reset PMEM to ensure consistent starting state
-        reset_pmem(pmem);
-
-        // Populate PMEM with initial data from CSV
-        std::ifstream init_file(argv[1]);
-        if (!init_file.is_open()) {
-            throw std::runtime_error("Failed to open CSV file for initialization.");
-        }
+        prepare_pmem(pmem, seed, image_path);
 
-        std::cout << "Populating PMEM from CSV file..." << std::endl;
-        std::string line;
-        while (std::getline(init_file, line)) {
-            std::istringstream ss(line);
-            std::string key, value;
-            if (!std::getline(ss, key, ',') || !std::getline(ss, value)) {
-                continue; // Skip malformed lines
-            }
+        // Populate PMEM with initial data from the trace file (CSV or binary)
+        TraceReader init_file(argv[1]);
 
+        std::cout << "Populating PMEM from trace file..." << std::endl;
+        std::string key, value;
+        while (init_file.next(key, value)) {
             // Compute page index based on hashed key
             std::hash<std::string> hasher;
             size_t hash_value = hasher(key);
@@ -43,25 +38,15 @@ int main(int argc, char* argv[]) {
             // Write value to the determined page
             memcpy(page_addr, value.data(), std::min(value.size(), PAGE_SIZE));
         }
-        init_file.close();
 
-        // Open the CSV file again for write queries
-        std::ifstream query_file(argv[1]);
-        if (!query_file.is_open()) {
-            throw std::runtime_error("Failed to open CSV file for queries.");
-        }
+        // Open the trace file again for write queries
+        TraceReader query_file(argv[1]);
 
         size_t total_bit_flips = 0;
         size_t query_count = 0;
 
-        std::cout << "Processing write queries from CSV file (first 1000 entries)..." << std::endl;
-        while (std::getline(query_file, line) && query_count < 100000) {
-            std::istringstream ss(line);
-            std::string key, value;
-            if (!std::getline(ss, key, ',') || !std::getline(ss, value)) {
-                continue; // Skip malformed lines
-            }
-
+        std::cout << "Processing write queries from trace file (first 1000 entries)..." << std::endl;
+        while (query_count < 100000 && query_file.next(key, value)) {
             // Select a random page for the write operation
             size_t page_index = rand() % NUM_PAGES;
             uint8_t* page_addr = pmem + (page_index * PAGE_SIZE);
@@ -74,7 +59,6 @@ int main(int argc, char* argv[]) {
             ++query_count;
         }
 
-        query_file.close();
         std::cout << "Total bit flips (default behavior): " << total_bit_flips << std::endl;
 
         // Cleanup
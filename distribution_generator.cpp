@@ -2,140 +2,272 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <unordered_set>
 #include <random>
 #include <cmath>
+#include <charconv>
+#include <algorithm>
+#include <thread>
 #include <stdexcept>
+#include "trace.h"
 
-// Function to generate a random string
-std::string generate_random_string(size_t length) {
+// Records generated together from one RNG stream
+const size_t CHUNK_RECORDS = 1 << 16;
+
+// Limits for command-line options
+const uint64_t MAX_RECORDS = 1ULL << 40;       // Far beyond any practical trace, safe from size overflow
+const uint64_t MAX_VALUE_LENGTH = 4096;        // One PMEM page; longer values are truncated on write
+const uint64_t MAX_THREADS = 1024;
+
+// Generator configuration, set from the command line
+struct GeneratorOptions {
+    size_t num_records = 100000;   // Number of records to generate
+    size_t num_keys = 0;           // Size of the key space (0 means num_records)
+    size_t value_length = 100;     // Value length in bytes
+    unsigned int num_threads = 0;  // Worker threads (0 means hardware concurrency)
+    uint64_t seed = std::random_device{}();
+    bool binary = false;           // Write the binary trace format instead of CSV
+};
+
+// Function to append a random alphanumeric string. Each 64-bit draw is read as
+// a fraction and expanded into several base-62 digits.
+void append_random_string(std::string& out, size_t length, std::mt19937_64& rng) {
     const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-    std::string result;
-    result.reserve(length);
-    std::default_random_engine rng(std::random_device{}());
-    std::uniform_int_distribution<> dist(0, sizeof(charset) - 2);
-    for (size_t i = 0; i < length; i++) {
-        result += charset[dist(rng)];
-    }
-    return result;
+    const size_t charset_size = sizeof(charset) - 1;
+    const size_t chars_per_draw = 8;
+    for (size_t i = 0; i < length; i += chars_per_draw) {
+        uint64_t bits = rng();
+        for (size_t j = i; j < std::min(i + chars_per_draw, length); j++) {
+            unsigned __int128 product = static_cast<unsigned __int128>(bits) * charset_size;
+            out += charset[static_cast<size_t>(product >> 64)];
+            bits = static_cast<uint64_t>(product);
+        }
+    }
 }
 
-// Function to generate uniform distribution
-void generate_uniform(const std::string& filename, size_t num_records, size_t value_length) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
+// Function to append one record in the requested output format
+void append_record(std::string& out, uint64_t key_index, const GeneratorOptions& options, std::mt19937_64& rng) {
+    if (options.binary) {
+        out.append(reinterpret_cast<const char*>(&key_index), sizeof(key_index));
+    } else {
+        char key_buffer[24];
+        auto result = std::to_chars(key_buffer, key_buffer + sizeof(key_buffer), key_index);
+        out += "key";
+        out.append(key_buffer, result.ptr);
+        out += ',';
     }
-
-    for (size_t i = 0; i < num_records; ++i) {
-        file << "key" << i << "," << generate_random_string(value_length) << "\n";
+    append_random_string(out, options.value_length, rng);
+    if (!options.binary) {
+        out += '\n';
     }
-    file.close();
-    std::cout << "Uniform distribution written to " << filename << std::endl;
 }
 
-// Function to generate zipfian distribution
-void generate_zipfian(const std::string& filename, size_t num_records, size_t value_length, double s = 1.0) {
-    std::ofstream file(filename);
+// Generate num_records records in parallel chunks. Chunk c is produced from its
+// own RNG stream seeded with (seed, c), so the output depends only on the seed
+// and not on the number of threads. sample_key(rng, record_index) picks the key.
+template <typename KeySampler>
+void generate_trace(const std::string& filename, const GeneratorOptions& options, KeySampler sample_key) {
+    std::ofstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Failed to open file: " + filename);
     }
 
-    double total = 0.0;
-    for (size_t i = 1; i <= num_records; ++i) {
-        total += 1.0 / std::pow(i, s);
+    if (options.binary) {
+        TraceHeader header;
+        memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.num_records = options.num_records;
+        header.value_length = options.value_length;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
     }
 
-    std::default_random_engine rng(std::random_device{}());
-    std::uniform_real_distribution<> dist(0.0, total);
+    unsigned int num_threads = options.num_threads;
+    if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
 
-    for (size_t i = 0; i < num_records; ++i) {
-        double random_value = dist(rng);
-        double cumulative = 0.0;
-        size_t chosen_key = 0;
+    size_t num_chunks = (options.num_records + CHUNK_RECORDS - 1) / CHUNK_RECORDS;
+    std::vector<std::string> buffers(num_threads);
 
-        for (size_t j = 1; j <= num_records; ++j) {
-            cumulative += 1.0 / std::pow(j, s);
-            if (cumulative >= random_value) {
-                chosen_key = j - 1;
-                break;
-            }
-        }
+    // Each round generates up to num_threads chunks, then writes them in order
+    for (size_t round_start = 0; round_start < num_chunks; round_start += num_threads) {
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < num_threads && round_start + t < num_chunks; t++) {
+            threads.emplace_back([&, t]() {
+                size_t chunk = round_start + t;
+                size_t begin = chunk * CHUNK_RECORDS;
+                size_t end = std::min(begin + CHUNK_RECORDS, options.num_records);
 
-        file << "key" << chosen_key << "," << generate_random_string(value_length) << "\n";
+                std::seed_seq seq{static_cast<uint32_t>(options.seed), static_cast<uint32_t>(options.seed >> 32),
+                                  static_cast<uint32_t>(chunk), static_cast<uint32_t>(chunk >> 32)};
+                std::mt19937_64 rng(seq);
+
+                std::string& buffer = buffers[t];
+                buffer.clear();
+                for (size_t i = begin; i < end; i++) {
+                    append_record(buffer, sample_key(rng, i), options, rng);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            file.write(buffers[t].data(), buffers[t].size());
+        }
     }
 
+    if (!file) {
+        throw std::runtime_error("Failed to write file: " + filename);
+    }
     file.close();
-    std::cout << "Zipfian distribution written to " << filename << std::endl;
 }
 
-// Function to generate latest distribution
-void generate_latest(const std::string& filename, size_t num_records, size_t value_length) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
+// Function to generate uniform distribution
+void generate_uniform(const std::string& filename, const GeneratorOptions& options) {
+    generate_trace(filename, options, [&](std::mt19937_64&, size_t i) { return i % options.num_keys; });
+    std::cout << "Uniform distribution written to " << filename << std::endl;
+}
+
+// Zipfian sampler over keys 0..num_keys-1 with P(k) proportional to 1/(k+1)^s,
+// using rejection-inversion (Hormann and Derflinger, 1996). It needs O(1) memory
+// and O(1) expected time per sample, independent of the key space size.
+class ZipfianSampler {
+private:
+    double s;
+    double num_keys;
+    double h_integral_x1;
+    double h_integral_num_keys;
+    double squeeze;
+
+    // log1p(x) / x, accurate near 0
+    static double helper1(double x) {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
     }
 
-    std::default_random_engine rng(std::random_device{}());
-    std::uniform_int_distribution<> dist(0, num_records - 1);
+    // expm1(x) / x, accurate near 0
+    static double helper2(double x) {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+    }
 
-    for (size_t i = 0; i < num_records; ++i) {
-        size_t recent_key_index = dist(rng) % 100;
-        file << "key" << recent_key_index << "," << generate_random_string(value_length) << "\n";
+    double h(double x) const {
+        return std::exp(-s * std::log(x));
     }
 
-    file.close();
-    std::cout << "Latest distribution written to " << filename << std::endl;
-}
+    // Integral of h from 1 to x, up to a constant
+    double h_integral(double x) const {
+        double log_x = std::log(x);
+        return helper2((1.0 - s) * log_x) * log_x;
+    }
 
-// Function to generate hotspot distribution
-void generate_hotspot(const std::string& filename, size_t num_records, size_t value_length, double hotspot_fraction = 0.2, double hotspot_op_fraction = 0.8) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
+    double h_integral_inverse(double x) const {
+        double t = std::max(-1.0, x * (1.0 - s));
+        return std::exp(helper1(t) * x);
     }
 
-    size_t hotspot_size = num_records * hotspot_fraction;
-    std::default_random_engine rng(std::random_device{}());
-    std::uniform_int_distribution<> hotspot_dist(0, hotspot_size - 1);
-    std::uniform_int_distribution<> coldspot_dist(hotspot_size, num_records - 1);
-    std::bernoulli_distribution is_hotspot(hotspot_op_fraction);
+public:
+    ZipfianSampler(size_t num_keys, double s) : s(s), num_keys(static_cast<double>(num_keys)) {
+        if (!(s > 0.0)) {
+            throw std::invalid_argument("Zipfian parameter must be positive");
+        }
+        h_integral_x1 = h_integral(1.5) - 1.0;
+        h_integral_num_keys = h_integral(this->num_keys + 0.5);
+        squeeze = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+    }
 
-    for (size_t i = 0; i < num_records; ++i) {
-        size_t key_index = is_hotspot(rng) ? hotspot_dist(rng) : coldspot_dist(rng);
-        file << "key" << key_index << "," << generate_random_string(value_length) << "\n";
+    size_t operator()(std::mt19937_64& rng) const {
+        std::uniform_real_distribution<> dist(0.0, 1.0);
+        while (true) {
+            double u = h_integral_num_keys + dist(rng) * (h_integral_x1 - h_integral_num_keys);
+            double x = h_integral_inverse(u);
+            double k = std::floor(x + 0.5);
+            k = std::min(std::max(k, 1.0), num_keys);
+            if (k - x <= squeeze || u >= h_integral(k + 0.5) - h(k)) {
+                return static_cast<size_t>(k) - 1;
+            }
+        }
     }
+};
 
-    file.close();
+// Function to generate zipfian distribution
+void generate_zipfian(const std::string& filename, const GeneratorOptions& options, double s = 1.0) {
+    ZipfianSampler sampler(options.num_keys, s);
+    generate_trace(filename, options, [&](std::mt19937_64& rng, size_t) { return sampler(rng); });
+    std::cout << "Zipfian distribution written to " << filename << std::endl;
+}
+
+// Function to generate latest distribution
+void generate_latest(const std::string& filename, const GeneratorOptions& options) {
+    generate_trace(filename, options, [&](std::mt19937_64& rng, size_t) {
+        std::uniform_int_distribution<size_t> dist(0, options.num_keys - 1);
+        return dist(rng) % 100;
+    });
+    std::cout << "Latest distribution written to " << filename << std::endl;
+}
+
+// Function to generate hotspot distribution
+void generate_hotspot(const std::string& filename, const GeneratorOptions& options, double hotspot_fraction = 0.2, double hotspot_op_fraction = 0.8) {
+    size_t hotspot_size = std::max<size_t>(1, options.num_keys * hotspot_fraction);
+    if (hotspot_size >= options.num_keys) {
+        throw std::invalid_argument("hotspot_fraction leaves no cold keys");
+    }
+
+    generate_trace(filename, options, [&](std::mt19937_64& rng, size_t) {
+        std::uniform_int_distribution<size_t> hotspot_dist(0, hotspot_size - 1);
+        std::uniform_int_distribution<size_t> coldspot_dist(hotspot_size, options.num_keys - 1);
+        std::bernoulli_distribution is_hotspot(hotspot_op_fraction);
+        return is_hotspot(rng) ? hotspot_dist(rng) : coldspot_dist(rng);
+    });
     std::cout << "Hotspot distribution written to " << filename << std::endl;
 }
 
 // Entry point for the program
 int main(int argc, char* argv[]) {
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <distribution> <output_file> [optional parameters]\n";
+        std::cerr << "Usage: " << argv[0] << " <distribution> <output_file> [optional parameters] [options]\n";
         std::cerr << "Supported distributions: uniform, zipfian, latest, hotspot\n";
+        std::cerr << "Options: --records N, --keys N, --value-length N, --threads N, --seed N, --binary\n";
         return 1;
     }
 
     std::string distribution = argv[1];
     std::string filename = argv[2];
 
-    const size_t num_records = 100000; // Default number of records
-    const size_t value_length = 100;   // Default value length
-
     try {
+        // Split remaining arguments into options and positional distribution parameters
+        GeneratorOptions options;
+        std::vector<std::string> params;
+        for (int i = 3; i < argc; i++) {
+            std::string arg = argv[i];
+            auto next_value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+                return argv[++i];
+            };
+            if (arg == "--records") {
+                options.num_records = parse_unsigned_argument(next_value(), "--records", 1, MAX_RECORDS);
+            } else if (arg == "--keys") {
+                options.num_keys = parse_unsigned_argument(next_value(), "--keys", 1, MAX_RECORDS);
+            } else if (arg == "--value-length") {
+                options.value_length = parse_unsigned_argument(next_value(), "--value-length", 1, MAX_VALUE_LENGTH);
+            } else if (arg == "--threads") {
+                options.num_threads = parse_unsigned_argument(next_value(), "--threads", 1, MAX_THREADS);
+            } else if (arg == "--seed") {
+                options.seed = parse_unsigned_argument(next_value(), "--seed");
+            } else if (arg == "--binary") {
+                options.binary = true;
+            } else {
+                params.push_back(arg);
+            }
+        }
+        if (options.num_keys == 0) options.num_keys = options.num_records;
+
         if (distribution == "uniform") {
-            generate_uniform(filename, num_records, value_length);
+            generate_uniform(filename, options);
         } else if (distribution == "zipfian") {
-            double s = (argc >= 4) ? std::stod(argv[3]) : 1.0; // Zipfian parameter (optional)
-            generate_zipfian(filename, num_records, value_length, s);
+            double s = (params.size() >= 1) ? std::stod(params[0]) : 1.0; // Zipfian parameter (optional)
+            generate_zipfian(filename, options, s);
         } else if (distribution == "latest") {
-            generate_latest(filename, num_records, value_length);
+            generate_latest(filename, options);
         } else if (distribution == "hotspot") {
-            double hotspot_fraction = (argc >= 4) ? std::stod(argv[3]) : 0.2;   // Optional parameter
-            double hotspot_op_fraction = (argc >= 5) ? std::stod(argv[4]) : 0.8; // Optional parameter
-            generate_hotspot(filename, num_records, value_length, hotspot_fraction, hotspot_op_fraction);
+            double hotspot_fraction = (params.size() >= 1) ? std::stod(params[0]) : 0.2;   // Optional parameter
+            double hotspot_op_fraction = (params.size() >= 2) ? std::stod(params[1]) : 0.8; // Optional parameter
+            generate_hotspot(filename, options, hotspot_fraction, hotspot_op_fraction);
         } else {
             std::cerr << "Unknown distribution: " << distribution << "\n";
             return 1;
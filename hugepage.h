@@ -0,0 +1,127 @@
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024; // x86-64 huge page size
+const int MPOL_BIND_MODE = 2;                  // MPOL_BIND from <linux/mempolicy.h>
+const unsigned MPOL_MF_MOVE_FLAG = 1 << 1;     // MPOL_MF_MOVE from <linux/mempolicy.h>
+const int MAX_NUMA_NODES = 64;                 // Nodes addressable by the single-word node mask
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23                 // Linux 5.14+, missing from older headers
+#endif
+
+// Prefault [addr, addr + length) for writing. Unlike touching the pages, a
+// failure to back them (e.g. no free huge pages) is returned instead of raising
+// SIGBUS. Returns false on failure or on kernels without MADV_POPULATE_WRITE.
+inline bool populate_for_write(void* addr, size_t length) {
+    return madvise(addr, length, MADV_POPULATE_WRITE) == 0;
+}
+
+// Memory placement for the PQ index (centroids and page codes)
+struct MemoryOptions {
+    bool huge_pages = false; // Back allocations with huge pages
+    int numa_node = -1;      // Bind allocations to this NUMA node (-1 leaves placement to the kernel)
+};
+
+// Bind [addr, addr + length) to a NUMA node. Must run before the pages are first touched.
+inline bool bind_to_numa_node(void* addr, size_t length, int numa_node) {
+    if (numa_node < 0 || numa_node >= MAX_NUMA_NODES) return false;
+    unsigned long nodemask = 1UL << numa_node;
+    // The kernel reads maxnode - 1 bits of the mask
+    return syscall(SYS_mbind, addr, length, MPOL_BIND_MODE, &nodemask,
+                   sizeof(nodemask) * 8 + 1, MPOL_MF_MOVE_FLAG) == 0;
+}
+
+// Allocator placing containers in their own huge-page mapping, optionally bound
+// to a NUMA node. Explicit huge pages (MAP_HUGETLB) are tried first; without a
+// hugetlb pool, or without free huge pages on the bound node, it falls back to
+// transparent huge pages (MADV_HUGEPAGE).
+template <typename T>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    MemoryOptions options;
+
+    HugePageAllocator(const MemoryOptions& options = MemoryOptions()) : options(options) {}
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>& other) : options(other.options) {}
+
+    T* allocate(size_t n) {
+        if (!options.huge_pages && options.numa_node < 0) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+
+        size_t length = mapping_length(n);
+        void* addr = MAP_FAILED;
+        if (options.huge_pages) {
+            addr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+        if (addr != MAP_FAILED && options.numa_node >= 0) {
+            // The hugetlb reservation is global, so the bound node may still run
+            // out of huge pages; prefault here and fall back to transparent huge
+            // pages rather than take SIGBUS on first touch
+            bind_or_throw(addr, length);
+            if (!populate_for_write(addr, length)) {
+                munmap(addr, length);
+                addr = MAP_FAILED;
+            }
+        }
+        if (addr == MAP_FAILED) {
+            addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            if (options.huge_pages) {
+                madvise(addr, length, MADV_HUGEPAGE);
+            }
+            if (options.numa_node >= 0) {
+                bind_or_throw(addr, length);
+            }
+        }
+        return static_cast<T*>(addr);
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (!options.huge_pages && options.numa_node < 0) {
+            ::operator delete(p);
+        } else {
+            munmap(p, mapping_length(n));
+        }
+    }
+
+private:
+    void bind_or_throw(void* addr, size_t length) const {
+        if (!bind_to_numa_node(addr, length, options.numa_node)) {
+            munmap(addr, length);
+            throw std::runtime_error("Failed to bind memory to NUMA node " + std::to_string(options.numa_node));
+        }
+    }
+
+    static size_t mapping_length(size_t n) {
+        return (n * sizeof(T) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const HugePageAllocator<T>& a, const HugePageAllocator<U>& b) {
+    return a.options.huge_pages == b.options.huge_pages && a.options.numa_node == b.options.numa_node;
+}
+
+template <typename T, typename U>
+bool operator!=(const HugePageAllocator<T>& a, const HugePageAllocator<U>& b) {
+    return !(a == b);
+}
+
+#endif // HUGEPAGE_H
@@ -0,0 +1,116 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <ostream>
+#include <vector>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Hardware counters for the calling thread, read through perf_event_open.
+// All counters are opened as one group, so they are scheduled together and
+// ratios such as dTLB misses per load come from the same time window. If the
+// kernel multiplexes the group, values are scaled by time enabled / time running.
+// Counters the kernel refuses (no PMU, perf_event_paranoid) are reported as unavailable.
+class PerfCounters {
+private:
+    struct Counter {
+        std::string name;
+        int fd;
+    };
+    std::vector<Counter> counters;
+    int group_fd = -1; // First counter that opened; leads the group
+
+    int open_counter(uint32_t type, uint64_t config) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = group_fd < 0 ? 1 : 0; // Members follow the leader
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+        if (fd >= 0 && group_fd < 0) group_fd = fd;
+        return fd;
+    }
+
+    static uint64_t cache_config(uint64_t cache, uint64_t op, uint64_t result) {
+        return cache | (op << 8) | (result << 16);
+    }
+
+public:
+    PerfCounters() {
+        counters.push_back({"dTLB load misses", open_counter(PERF_TYPE_HW_CACHE,
+            cache_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS))});
+        counters.push_back({"dTLB loads", open_counter(PERF_TYPE_HW_CACHE,
+            cache_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS))});
+        counters.push_back({"cycles", open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES)});
+        counters.push_back({"instructions", open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS)});
+    }
+
+    ~PerfCounters() {
+        // Members before the leader
+        for (auto it = counters.rbegin(); it != counters.rend(); ++it) {
+            if (it->fd >= 0) close(it->fd);
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start() {
+        if (group_fd < 0) return;
+        ioctl(group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    void stop() {
+        if (group_fd >= 0) ioctl(group_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // Print every counter, total and per operation
+    void report(std::ostream& out, size_t num_operations) const {
+        // Group read layout: nr, time_enabled, time_running, value[nr] in open order
+        std::vector<uint64_t> data(3 + counters.size(), 0);
+        ssize_t size = -1;
+        if (group_fd >= 0) {
+            size = read(group_fd, data.data(), data.size() * sizeof(uint64_t));
+        }
+        uint64_t num_values = size >= static_cast<ssize_t>(3 * sizeof(uint64_t)) ? data[0] : 0;
+        uint64_t time_enabled = data[1];
+        uint64_t time_running = data[2];
+
+        if (num_values > 0 && time_running == 0) {
+            out << "Counter group was never scheduled on the PMU" << std::endl;
+        } else if (num_values > 0 && time_running < time_enabled) {
+            out << "Counter group multiplexed: running " << 100.0 * time_running / time_enabled
+                << "% of the time, values scaled" << std::endl;
+        }
+
+        size_t index = 0; // Position among the counters that opened
+        for (const auto& counter : counters) {
+            if (counter.fd < 0 || index >= num_values || time_running == 0) {
+                out << counter.name << ": unavailable" << std::endl;
+                if (counter.fd >= 0) index++;
+                continue;
+            }
+            double value = static_cast<double>(data[3 + index++]);
+            if (time_running < time_enabled) {
+                value *= static_cast<double>(time_enabled) / time_running;
+            }
+            out << counter.name << ": " << static_cast<uint64_t>(value);
+            if (num_operations > 0) {
+                out << " (" << value / num_operations << " per write)";
+            }
+            out << std::endl;
+        }
+    }
+};
+
+#endif // PERF_COUNTERS_H
@@ -8,19 +8,64 @@
 #include <thread>
 #include <mutex>
 #include <unordered_set>
+#include <stdexcept>
 #include <chrono> // Include for timing
 #include "common.h" 
+#include "hugepage.h"
 
 const size_t SUBVECTOR_SIZE = 16;  
 const size_t NUM_CENTROIDS = 256; 
 const size_t NUM_SUBVECTORS = PAGE_SIZE / SUBVECTOR_SIZE;
+const size_t PAGE_BLOCK_SIZE = 64;       // Pages compared per block in batched distance computation
+const size_t HUNGARIAN_MAX_BATCH = 64;   // Largest batch solved exactly; larger batches use greedy assignment
+
+// Working storage for batched placement. Reusing one per thread, reserved for
+// the largest batch, keeps find_nearest_pages free of heap allocations.
+struct PlacementScratch {
+    std::vector<uint8_t> write_codes;   // [write][subvector_indices]
+    std::vector<uint32_t> distances;    // [write][page]
+    // Hungarian algorithm state
+    std::vector<int64_t> u, v, minv;
+    std::vector<size_t> p, way;
+    std::vector<bool> used;
+    // Greedy assignment state
+    std::vector<uint32_t> margins;
+    std::vector<size_t> order;
+    std::vector<bool> taken;
+
+    // Size every buffer for batches of up to max_batch_size writes, so neither
+    // assignment path grows after warm-up (a short final batch may switch paths)
+    void reserve(size_t max_batch_size) {
+        write_codes.reserve(max_batch_size * NUM_SUBVECTORS);
+        distances.reserve(max_batch_size * NUM_PAGES);
+        u.reserve(std::min(max_batch_size, HUNGARIAN_MAX_BATCH) + 1);
+        v.reserve(NUM_PAGES + 1);
+        minv.reserve(NUM_PAGES + 1);
+        p.reserve(NUM_PAGES + 1);
+        way.reserve(NUM_PAGES + 1);
+        used.reserve(NUM_PAGES + 1);
+        margins.reserve(max_batch_size);
+        order.reserve(max_batch_size);
+        taken.reserve(NUM_PAGES);
+    }
+};
 
 class ProductQuantizer {
 private:
-    // For each subvector position, store its centroids
-    std::vector<std::vector<std::vector<uint8_t>>> centroids;  // [subvector_position][centroid_id][bytes]
-    // For each page, store centroid indices for each subvector
-    std::vector<std::vector<uint8_t>> encoded_pages;  // [page_id][subvector_indices]
+    using HugePageVector = std::vector<uint8_t, HugePageAllocator<uint8_t>>;
+
+    // For each subvector position, store its centroids contiguously
+    HugePageVector centroids;  // [subvector_position][centroid_id][bytes]
+    // For each page, store centroid indices for each subvector contiguously
+    HugePageVector encoded_pages;  // [page_id][subvector_indices]
+
+    const uint8_t* centroid(size_t pos, size_t c) const {
+        return centroids.data() + ((pos * NUM_CENTROIDS + c) * SUBVECTOR_SIZE);
+    }
+
+    const uint8_t* page_codes(size_t page) const {
+        return encoded_pages.data() + (page * NUM_SUBVECTORS);
+    }
 
     // Timing accumulators
     std::chrono::duration<double> total_count_bit_flips_time = std::chrono::duration<double>::zero();
@@ -144,9 +189,182 @@ private:
         return position_centroids;
     }
 
+    // Encode a write into one centroid index per subvector position
+    void encode_write(const uint8_t* write_data, uint8_t* write_centroids) {
+        auto start_encoding = std::chrono::high_resolution_clock::now();
+
+        for (size_t pos = 0; pos < NUM_SUBVECTORS; pos++) {
+            const uint8_t* subvector = write_data + (pos * SUBVECTOR_SIZE);
+            size_t best_centroid = 0;
+            size_t min_distance = std::numeric_limits<size_t>::max();
+            
+            auto start_bit_flips = std::chrono::high_resolution_clock::now();
+            for (size_t c = 0; c < NUM_CENTROIDS; c++) {
+                size_t distance = count_bit_flips(
+                    subvector,
+                    centroid(pos, c),
+                    SUBVECTOR_SIZE
+                );
+                if (distance < min_distance) {
+                    min_distance = distance;
+                    best_centroid = c;
+                }
+            }
+            auto end_bit_flips = std::chrono::high_resolution_clock::now();
+            total_count_bit_flips_time += (end_bit_flips - start_bit_flips);
+            count_bit_flips_total_calls += NUM_CENTROIDS;
+            
+            write_centroids[pos] = best_centroid;
+        }
+        auto end_encoding = std::chrono::high_resolution_clock::now();
+        total_encoding_time += (end_encoding - start_encoding);
+        encoding_total_calls++;
+    }
+
+    // Fill distances[w * NUM_PAGES + page] for every write/page pair. Pages are
+    // visited in blocks so each block of page codes stays in cache while all
+    // writes of the batch are compared against it.
+    void compute_distance_matrix(const std::vector<uint8_t>& write_codes, size_t num_writes,
+                                 std::vector<uint32_t>& distances) {
+        auto start_distance_calc = std::chrono::high_resolution_clock::now();
+
+        distances.resize(num_writes * NUM_PAGES);
+        for (size_t block = 0; block < NUM_PAGES; block += PAGE_BLOCK_SIZE) {
+            size_t block_end = std::min(block + PAGE_BLOCK_SIZE, NUM_PAGES);
+            for (size_t w = 0; w < num_writes; w++) {
+                const uint8_t* codes = write_codes.data() + (w * NUM_SUBVECTORS);
+                uint32_t* row = distances.data() + (w * NUM_PAGES);
+                for (size_t page = block; page < block_end; page++) {
+                    const uint8_t* codes_of_page = page_codes(page);
+                    uint32_t distance = 0;
+                    for (size_t pos = 0; pos < NUM_SUBVECTORS; pos++) {
+                        distance += codes[pos] != codes_of_page[pos];
+                    }
+                    row[page] = distance;
+                }
+            }
+        }
+
+        auto end_distance_calc = std::chrono::high_resolution_clock::now();
+        total_distance_calculation_time += (end_distance_calc - start_distance_calc);
+        distance_calculation_total_calls += num_writes * NUM_PAGES;
+    }
+
+    // Optimal assignment of writes (rows) to distinct pages (columns) using the
+    // Hungarian algorithm with potentials, O(num_writes^2 * NUM_PAGES)
+    void assign_hungarian(PlacementScratch& scratch, size_t num_writes, size_t* assignment) {
+        const int64_t INF = std::numeric_limits<int64_t>::max() / 2;
+        const size_t n = num_writes, m = NUM_PAGES;
+        const std::vector<uint32_t>& distances = scratch.distances;
+        std::vector<int64_t>& u = scratch.u;
+        std::vector<int64_t>& v = scratch.v;
+        std::vector<int64_t>& minv = scratch.minv;
+        std::vector<size_t>& p = scratch.p;
+        std::vector<size_t>& way = scratch.way;
+        std::vector<bool>& used = scratch.used;
+        u.assign(n + 1, 0);
+        v.assign(m + 1, 0);
+        p.assign(m + 1, 0);
+        way.assign(m + 1, 0);
+
+        for (size_t i = 1; i <= n; i++) {
+            p[0] = i;
+            size_t j0 = 0;
+            minv.assign(m + 1, INF);
+            used.assign(m + 1, false);
+            do {
+                used[j0] = true;
+                size_t i0 = p[j0], j1 = 0;
+                int64_t delta = INF;
+                for (size_t j = 1; j <= m; j++) {
+                    if (used[j]) continue;
+                    int64_t cur = distances[(i0 - 1) * m + (j - 1)] - u[i0] - v[j];
+                    if (cur < minv[j]) {
+                        minv[j] = cur;
+                        way[j] = j0;
+                    }
+                    if (minv[j] < delta) {
+                        delta = minv[j];
+                        j1 = j;
+                    }
+                }
+                for (size_t j = 0; j <= m; j++) {
+                    if (used[j]) {
+                        u[p[j]] += delta;
+                        v[j] -= delta;
+                    } else {
+                        minv[j] -= delta;
+                    }
+                }
+                j0 = j1;
+            } while (p[j0] != 0);
+            do {
+                size_t j1 = way[j0];
+                p[j0] = p[j1];
+                j0 = j1;
+            } while (j0 != 0);
+        }
+
+        for (size_t j = 1; j <= m; j++) {
+            if (p[j] != 0) assignment[p[j] - 1] = j - 1;
+        }
+    }
+
+    // Greedy assignment: writes whose best page beats their second-best page by
+    // the largest margin pick first, each taking its nearest still-free page
+    void assign_greedy_by_margin(PlacementScratch& scratch, size_t num_writes, size_t* assignment) {
+        const std::vector<uint32_t>& distances = scratch.distances;
+        std::vector<uint32_t>& margins = scratch.margins;
+        margins.resize(num_writes);
+        for (size_t w = 0; w < num_writes; w++) {
+            const uint32_t* row = distances.data() + (w * NUM_PAGES);
+            uint32_t best = std::numeric_limits<uint32_t>::max();
+            uint32_t second = std::numeric_limits<uint32_t>::max();
+            for (size_t page = 0; page < NUM_PAGES; page++) {
+                if (row[page] < best) {
+                    second = best;
+                    best = row[page];
+                } else if (row[page] < second) {
+                    second = row[page];
+                }
+            }
+            margins[w] = second - best;
+        }
+
+        // std::sort rather than std::stable_sort, which allocates a temporary
+        // buffer; ties are broken by write index to keep the order stable
+        std::vector<size_t>& order = scratch.order;
+        order.resize(num_writes);
+        for (size_t w = 0; w < num_writes; w++) order[w] = w;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return margins[a] != margins[b] ? margins[a] > margins[b] : a < b;
+        });
+
+        std::vector<bool>& taken = scratch.taken;
+        taken.assign(NUM_PAGES, false);
+        for (size_t w : order) {
+            const uint32_t* row = distances.data() + (w * NUM_PAGES);
+            size_t best_page = 0;
+            uint32_t min_distance = std::numeric_limits<uint32_t>::max();
+            for (size_t page = 0; page < NUM_PAGES; page++) {
+                if (!taken[page] && row[page] < min_distance) {
+                    min_distance = row[page];
+                    best_page = page;
+                }
+            }
+            taken[best_page] = true;
+            assignment[w] = best_page;
+        }
+    }
+
 public:
+    // Centroids and page codes are allocated according to memory_options
+    ProductQuantizer(const MemoryOptions& memory_options = MemoryOptions())
+        : centroids(HugePageAllocator<uint8_t>(memory_options)),
+          encoded_pages(HugePageAllocator<uint8_t>(memory_options)) {}
+
     void train(const uint8_t* pmem_data, const int max_iter = 100000) {
-        centroids.resize(NUM_SUBVECTORS);
+        centroids.assign(NUM_SUBVECTORS * NUM_CENTROIDS * SUBVECTOR_SIZE, 0);
 
         unsigned int num_threads = std::thread::hardware_concurrency() - 1;
         if (num_threads == 0) num_threads = 1;
@@ -163,7 +381,12 @@ public:
                         std::cout << "Training subvector position " << pos 
                                 << " on thread " << t << std::endl;
                     }
-                    centroids[pos] = train_subvector_position(pmem_data, pos, max_iter);
+                    std::vector<std::vector<uint8_t>> position_centroids =
+                        train_subvector_position(pmem_data, pos, max_iter);
+                    for (size_t c = 0; c < NUM_CENTROIDS; c++) {
+                        memcpy(centroids.data() + ((pos * NUM_CENTROIDS + c) * SUBVECTOR_SIZE),
+                               position_centroids[c].data(), SUBVECTOR_SIZE);
+                    }
                 }
             });
         }
@@ -175,9 +398,8 @@ public:
         
         
         // Encode all pages
-        encoded_pages.resize(NUM_PAGES);
+        encoded_pages.assign(NUM_PAGES * NUM_SUBVECTORS, 0);
         for (size_t page = 0; page < NUM_PAGES; page++) {
-            encoded_pages[page].resize(NUM_SUBVECTORS);
             const uint8_t* page_data = pmem_data + (page * PAGE_SIZE);
             
             for (size_t pos = 0; pos < NUM_SUBVECTORS; pos++) {
@@ -188,7 +410,7 @@ public:
                 for (size_t c = 0; c < NUM_CENTROIDS; c++) {
                     size_t distance = count_bit_flips(
                         subvector,
-                        centroids[pos][c].data(),
+                        centroid(pos, c),
                         SUBVECTOR_SIZE
                     );
                     if (distance < min_distance) {
@@ -196,45 +418,24 @@ public:
                         best_centroid = c;
                     }
                 }
-                encoded_pages[page][pos] = best_centroid;
+                encoded_pages[page * NUM_SUBVECTORS + pos] = best_centroid;
             }
         }
     }
 
     size_t find_nearest_page(const uint8_t* write_data) {
+        std::vector<uint8_t> write_centroids(NUM_SUBVECTORS);
+        return find_nearest_page(write_data, write_centroids.data());
+    }
+
+    // Same as above, encoding the write into caller-provided storage of
+    // NUM_SUBVECTORS bytes so that no allocation takes place
+    size_t find_nearest_page(const uint8_t* write_data, uint8_t* write_centroids) {
         auto start_find = std::chrono::high_resolution_clock::now();
         find_nearest_page_total_calls++;
 
         // Encoding the write data
-        auto start_encoding = std::chrono::high_resolution_clock::now();
-        std::vector<uint8_t> write_centroids(NUM_SUBVECTORS);
-        
-        for (size_t pos = 0; pos < NUM_SUBVECTORS; pos++) {
-            const uint8_t* subvector = write_data + (pos * SUBVECTOR_SIZE);
-            size_t best_centroid = 0;
-            size_t min_distance = std::numeric_limits<size_t>::max();
-            
-            auto start_bit_flips = std::chrono::high_resolution_clock::now();
-            for (size_t c = 0; c < NUM_CENTROIDS; c++) {
-                size_t distance = count_bit_flips(
-                    subvector,
-                    centroids[pos][c].data(),
-                    SUBVECTOR_SIZE
-                );
-                if (distance < min_distance) {
-                    min_distance = distance;
-                    best_centroid = c;
-                }
-            }
-            auto end_bit_flips = std::chrono::high_resolution_clock::now();
-            total_count_bit_flips_time += (end_bit_flips - start_bit_flips);
-            count_bit_flips_total_calls += NUM_CENTROIDS;
-            
-            write_centroids[pos] = best_centroid;
-        }
-        auto end_encoding = std::chrono::high_resolution_clock::now();
-        total_encoding_time += (end_encoding - start_encoding);
-        encoding_total_calls++;
+        encode_write(write_data, write_centroids);
 
         // Finding the nearest page
         size_t best_page = 0;
@@ -247,7 +448,7 @@ public:
             auto start_distance_calc = std::chrono::high_resolution_clock::now();
 
             for (size_t pos = 0; pos < NUM_SUBVECTORS; pos++) {
-                if (write_centroids[pos] != encoded_pages[page][pos]) {
+                if (write_centroids[pos] != encoded_pages[page * NUM_SUBVECTORS + pos]) {
                     distance++;
                 }
             }
@@ -268,6 +469,43 @@ public:
         return best_page;
     }
 
+    // Place a whole batch of writes jointly so that each write gets a distinct
+    // page. Small batches are solved exactly (Hungarian), larger ones greedily.
+    std::vector<size_t> find_nearest_pages(const std::vector<const uint8_t*>& writes) {
+        PlacementScratch scratch;
+        std::vector<size_t> assignment(writes.size());
+        find_nearest_pages(writes.data(), writes.size(), scratch, assignment.data());
+        return assignment;
+    }
+
+    // Same as above, working in caller-provided scratch and writing the page of
+    // writes[w] to assignment[w]
+    void find_nearest_pages(const uint8_t* const* writes, size_t num_writes,
+                            PlacementScratch& scratch, size_t* assignment) {
+        if (num_writes > NUM_PAGES) {
+            throw std::invalid_argument("Batch size exceeds number of pages.");
+        }
+
+        auto start_find = std::chrono::high_resolution_clock::now();
+        find_nearest_page_total_calls += num_writes;
+
+        scratch.write_codes.resize(num_writes * NUM_SUBVECTORS);
+        for (size_t w = 0; w < num_writes; w++) {
+            encode_write(writes[w], scratch.write_codes.data() + (w * NUM_SUBVECTORS));
+        }
+
+        compute_distance_matrix(scratch.write_codes, num_writes, scratch.distances);
+
+        if (num_writes <= HUNGARIAN_MAX_BATCH) {
+            assign_hungarian(scratch, num_writes, assignment);
+        } else {
+            assign_greedy_by_margin(scratch, num_writes, assignment);
+        }
+
+        auto end_find = std::chrono::high_resolution_clock::now();
+        total_find_nearest_page_time += (end_find - start_find);
+    }
+
     // Getter functions for average times
     double get_average_count_bit_flips_time() const { 
         return count_bit_flips_total_calls > 0 ? total_count_bit_flips_time.count() / count_bit_flips_total_calls : 0.0; 
@@ -1,8 +1,9 @@
 // pq_behavior.cpp
 #include "common.h"
 #include "pq_algorithm.cpp"
-#include <fstream>
-#include <sstream>
+#include "trace.h"
+#include "perf_counters.h"
+#include "alloc_counter.h"
 #include <functional>
 #include <chrono>
 #include <iostream>
@@ -11,25 +12,66 @@
 // Specify PMEM file path
 const char* PMEM_FILE_PATH = "/mnt/pmem/testfile";
 
+// Writes processed before the allocation check starts (COUNT_ALLOCATIONS builds)
+const size_t ALLOCATION_WARMUP_WRITES = 1000;
+
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <csv_file>" << std::endl;
+    auto print_usage = [&]() {
+        std::cerr << "Usage: " << argv[0] << " <trace_file> [batch_size] [seed] [image_file]"
+                  << " [--huge-pages] [--numa-node N]" << std::endl;
+    };
+
+    // Split memory placement options from positional arguments
+    MemoryOptions memory_options;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--huge-pages") {
+            memory_options.huge_pages = true;
+        } else if (arg == "--numa-node") {
+            try {
+                if (i + 1 >= argc) throw std::invalid_argument("Missing value for --numa-node");
+                uint64_t node = parse_unsigned_argument(argv[++i], "NUMA node");
+                if (node >= MAX_NUMA_NODES) throw std::invalid_argument("NUMA node must be below " + std::to_string(MAX_NUMA_NODES));
+                memory_options.numa_node = static_cast<int>(node);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                print_usage();
+                return 1;
+            }
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.empty()) {
+        print_usage();
         return 1;
     }
 
     try {
+        // Number of writes placed jointly; 1 places each write on its own
+        size_t batch_size = (args.size() >= 2) ? parse_unsigned_argument(args[1], "batch_size") : 1;
+        if (batch_size == 0 || batch_size > NUM_PAGES) {
+            throw std::invalid_argument("batch_size must be between 1 and " + std::to_string(NUM_PAGES));
+        }
+
+        // Seed of the initial PMEM content and optional image file to share it across runs
+        uint64_t seed = (args.size() >= 3) ? parse_unsigned_argument(args[2], "seed") : DEFAULT_PMEM_SEED;
+        std::string image_path = (args.size() >= 4) ? args[3] : "";
+
         // Start measuring total execution time
         auto start_time = std::chrono::high_resolution_clock::now();
 
         // Initialize PMEM
-        uint8_t* pmem = init_pmem();
+        uint8_t* pmem = init_pmem(memory_options.huge_pages);
 
         // Reset PMEM to ensure consistent starting state
-        reset_pmem(pmem);
+        prepare_pmem(pmem, seed, image_path);
 
         // Train Product Quantizer using PMEM's current state
         std::cout << "Training PQ algorithm on PMEM content..." << std::endl;
-        ProductQuantizer pq;
+        ProductQuantizer pq(memory_options);
         pq.train(pmem, 1000);
 
         // Record time after training
@@ -37,51 +79,93 @@ int main(int argc, char* argv[]) {
         std::chrono::duration<double> training_duration = after_training_time - start_time;
         std::cout << "Time taken for training: " << training_duration.count() << " seconds" << std::endl;
 
-        // Open the CSV file for testing writes
-        std::ifstream test_file(argv[1]);
-        if (!test_file.is_open()) {
-            throw std::runtime_error("Failed to open CSV file for testing.");
-        }
+        // Open the trace file (CSV or binary) for testing writes
+        TraceReader test_file(args[0]);
 
         size_t total_bit_flips = 0;
         double total_hamming_distance_percentage = 0.0;
         size_t write_count = 0;
 
-        // Read each key-value pair and perform PQ-based writes
-        std::cout << "Processing write queries from CSV file..." << std::endl;
-        std::string line;
-        while (std::getline(test_file, line)) {
-            std::istringstream ss(line);
-            std::string key, value;
-            if (!std::getline(ss, key, ',') || !std::getline(ss, value)) {
-                continue; // Skip malformed lines
-            }
-
-            // Hash the key for write query
-            std::hash<std::string> hasher;
-            size_t hash_value = hasher(key);
-
-            // Generate write object
-            Write write(value);
-
-            // Find the nearest page using PQ algorithm
-            size_t page_index = pq.find_nearest_page(write.get_page());
+        // Write a page of data to its assigned page and accumulate statistics
+        auto apply_write = [&](const uint8_t* write_data, size_t page_index) {
             uint8_t* page_addr = pmem + (page_index * PAGE_SIZE);
 
-            // Get the length of the query
-            size_t query_length = write.get_length();
-
             // Calculate Hamming distance percentage before writing
-            double hamming_distance_percentage = calculate_hamming_distance_percentage(page_addr, write.get_page(), query_length);
+            double hamming_distance_percentage = calculate_hamming_distance_percentage(page_addr, write_data, PAGE_SIZE);
             total_hamming_distance_percentage += hamming_distance_percentage;
             write_count++;
 
             // Calculate bit flips and write to PMEM
-            total_bit_flips += count_bit_flips(page_addr, write.get_page(), query_length);
-            memcpy(page_addr, write.get_page(), query_length);
+            total_bit_flips += count_bit_flips(page_addr, write_data, PAGE_SIZE);
+            memcpy(page_addr, write_data, PAGE_SIZE);
+        };
+
+        // Scratch storage reused by every query so the steady-state loop does not allocate
+        std::vector<Write> batch(batch_size);
+        std::vector<const uint8_t*> batch_pages(batch_size);
+        std::vector<size_t> page_indices(batch_size);
+        std::vector<uint8_t> write_centroids(NUM_SUBVECTORS);
+        PlacementScratch placement_scratch;
+        placement_scratch.reserve(batch_size);
+        size_t batch_count = 0;
+
+        // Pending writes for batched placement
+        auto flush_batch = [&]() {
+            if (batch_count == 0) return;
+            for (size_t i = 0; i < batch_count; i++) {
+                batch_pages[i] = batch[i].get_page();
+            }
+            pq.find_nearest_pages(batch_pages.data(), batch_count, placement_scratch, page_indices.data());
+            for (size_t i = 0; i < batch_count; i++) {
+                apply_write(batch[i].get_page(), page_indices[i]);
+            }
+            batch_count = 0;
+        };
+
+        // Allocations are only checked after warm-up, once every scratch buffer has grown
+        size_t warmup_writes = std::max(ALLOCATION_WARMUP_WRITES, 2 * batch_size);
+        size_t allocations_at_warmup = 0;
+        bool warmed_up = false;
+
+        // Read each key-value pair and perform PQ-based writes
+        std::cout << "Processing write queries from trace file with batch size " << batch_size << "..." << std::endl;
+        std::string key, value;
+        PerfCounters perf_counters;
+        perf_counters.start();
+        while (test_file.next(key, value)) {
+            // Hash the key for write query
+            std::hash<std::string> hasher;
+            [[maybe_unused]] size_t hash_value = hasher(key);
+
+            Write& write = batch[batch_count++];
+            write.assign(value.data(), value.size());
+            if (batch_size == 1) {
+                // Find the nearest page using PQ algorithm
+                apply_write(write.get_page(), pq.find_nearest_page(write.get_page(), write_centroids.data()));
+                batch_count = 0;
+            } else if (batch_count == batch_size) {
+                flush_batch();
+            }
+
+            if (!warmed_up && write_count >= warmup_writes) {
+                warmed_up = true;
+                allocations_at_warmup = allocations_so_far();
+            }
         }
+        flush_batch();
+        perf_counters.stop();
 
-        test_file.close();
+        if (ALLOCATION_COUNTING_ENABLED && !warmed_up) {
+            throw std::runtime_error("Allocation check needs at least " + std::to_string(warmup_writes) +
+                                     " writes to warm up, trace had " + std::to_string(write_count) + ".");
+        }
+        if (ALLOCATION_COUNTING_ENABLED) {
+            size_t steady_state_allocations = allocations_so_far() - allocations_at_warmup;
+            std::cout << "Heap allocations after warm-up: " << steady_state_allocations << std::endl;
+            if (steady_state_allocations > 0) {
+                throw std::runtime_error("Write path allocated after warm-up.");
+            }
+        }
 
         // Output total bit flips and average Hamming distance percentage
         std::cout << "Total bit flips (PQ behavior): " << total_bit_flips << std::endl;
@@ -98,6 +182,9 @@ int main(int argc, char* argv[]) {
         std::chrono::duration<double> total_duration = end_time - start_time;
 
         std::cout << "Time taken for processing queries: " << query_duration.count() << " seconds" << std::endl;
+        if (query_duration.count() > 0) {
+            std::cout << "Throughput: " << write_count / query_duration.count() << " writes/second" << std::endl;
+        }
         std::cout << "Total execution time: " << total_duration.count() << " seconds" << std::endl;
 
         // Report average timings from ProductQuantizer
@@ -111,6 +198,11 @@ int main(int argc, char* argv[]) {
         std::cout << "Average time for finding nearest page: " 
                   << pq.get_average_find_nearest_page_time() * 1e6 << " microseconds" << std::endl;
 
+        // Report hardware counters for the query phase
+        std::cout << "\n--- Hardware Counters (huge pages: " << (memory_options.huge_pages ? "on" : "off")
+                  << ", NUMA node: " << memory_options.numa_node << ") ---" << std::endl;
+        perf_counters.report(std::cout, write_count);
+
         // Cleanup
         munmap(pmem, PMEM_FILE_SIZE);
     } catch (const std::exception& e) {
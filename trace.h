@@ -0,0 +1,103 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+
+// Function to parse a non-negative integer command-line argument, rejecting trailing characters
+inline uint64_t parse_unsigned_argument(const std::string& text, const std::string& name) {
+    size_t parsed = 0;
+    uint64_t value = 0;
+    try {
+        if (!text.empty() && text[0] != '-') value = std::stoull(text, &parsed);
+    } catch (const std::exception&) {
+        parsed = 0;
+    }
+    if (parsed == 0 || parsed != text.size()) {
+        throw std::invalid_argument("Invalid " + name + ": '" + text + "'");
+    }
+    return value;
+}
+
+// Same as above, also requiring min_value <= value <= max_value
+inline uint64_t parse_unsigned_argument(const std::string& text, const std::string& name,
+                                        uint64_t min_value, uint64_t max_value) {
+    uint64_t value = parse_unsigned_argument(text, name);
+    if (value < min_value || value > max_value) {
+        throw std::invalid_argument(name + " must be between " + std::to_string(min_value) +
+                                    " and " + std::to_string(max_value));
+    }
+    return value;
+}
+
+// Binary trace format:
+//   header:  char magic[8] = "PQTRACE1", uint64_t num_records, uint64_t value_length
+//   records: uint64_t key_index, char value[value_length]
+// All integers are little-endian. Key index k stands for the key "key<k>" of the CSV format.
+const char TRACE_MAGIC[8] = {'P', 'Q', 'T', 'R', 'A', 'C', 'E', '1'};
+
+struct TraceHeader {
+    char magic[8];
+    uint64_t num_records;
+    uint64_t value_length;
+};
+
+// Sequential reader over a trace file in either CSV ("key,value" lines) or binary format
+class TraceReader {
+private:
+    std::ifstream file;
+    bool binary = false;
+    TraceHeader header{};
+    uint64_t records_read = 0;
+    std::string line;
+
+public:
+    explicit TraceReader(const std::string& filename) : file(filename, std::ios::binary) {
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open trace file: " + filename);
+        }
+
+        if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+            memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0) {
+            binary = true;
+        } else {
+            file.clear();
+            file.seekg(0);
+        }
+    }
+
+    // Read the next record into key and value, reusing their storage. Malformed
+    // CSV lines are skipped. Returns false at the end of the trace.
+    bool next(std::string& key, std::string& value) {
+        if (binary) {
+            if (records_read == header.num_records) return false;
+            uint64_t key_index;
+            if (!file.read(reinterpret_cast<char*>(&key_index), sizeof(key_index))) return false;
+            char key_buffer[32];
+            int key_length = snprintf(key_buffer, sizeof(key_buffer), "key%llu",
+                                      static_cast<unsigned long long>(key_index));
+            key.assign(key_buffer, key_length);
+            value.resize(header.value_length);
+            if (!file.read(&value[0], header.value_length)) return false;
+            records_read++;
+            return true;
+        }
+
+        while (std::getline(file, line)) {
+            size_t comma = line.find(',');
+            if (comma == std::string::npos || comma + 1 == line.size()) {
+                continue; // Skip malformed lines
+            }
+            key.assign(line, 0, comma);
+            value.assign(line, comma + 1, std::string::npos);
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif // TRACE_H